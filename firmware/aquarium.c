@@ -11,7 +11,6 @@
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
 #include <avr/pgmspace.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include "aquarium.h"
@@ -59,6 +58,9 @@ static struct
 {
     // Displaying mode
     uint8_t display;
+    // Brightness of the display while the light is on (day) and off (night)
+    uint8_t display_day;
+    uint8_t display_night;
 
     // Temperature of the water
     int8_t temperature;
@@ -129,6 +131,9 @@ static struct {
     uint8_t light_level;
     uint8_t light_rise_time;
 
+    uint8_t display_day;
+    uint8_t display_night;
+
 } config EEMEM = {
 // "config" stores some important values of "aquarium" structure in EEPROM.
 // Default values:
@@ -139,7 +144,8 @@ static struct {
     MODE_AUTO,
     MODE_AUTO,
     SHOW_TIME,
-    50, 15
+    50, 15,
+    DISPLAY_LEVEL_MAX, 2
 };
 
 static const char help_msg[] PROGMEM = "\r\nAvailable commands:\r\n\r\n"
@@ -163,9 +169,22 @@ static const char help_msg[] PROGMEM = "\r\nAvailable commands:\r\n\r\n"
                                        "light auto\r\n"
                                        "display time\r\n"
                                        "display temp\r\n"
+                                       "display level D-N\r\n"
                                        "reboot\r\n"
                                        "help\r\n\r\n";
 
+static const char monday[] PROGMEM = "Monday";
+static const char tuesday[] PROGMEM = "Tuesday";
+static const char wednesday[] PROGMEM = "Wednesday";
+static const char thursday[] PROGMEM = "Thursday";
+static const char friday[] PROGMEM = "Friday";
+static const char saturday[] PROGMEM = "Saturday";
+static const char sunday[] PROGMEM = "Sunday";
+
+static const char *const weekdays[7] PROGMEM = {
+    monday, tuesday, wednesday, thursday, friday, saturday, sunday
+};
+
 /* ------------------------------------------------------------------------- *
  * Send response about command processing to UART
  * ------------------------------------------------------------------------- */
@@ -189,22 +208,44 @@ static void uart_response(uint8_t response)
  * ------------------------------------------------------------------------- */
 static void uart_puti(int8_t value, uint8_t padding_zeros)
 {
+    uint8_t digits = (value < 0) ? -value : value;
+
     if (value < 0 )
     {
         uart_putc('-');
     }
 
-    if (labs(value) >= 100 || padding_zeros >= 3)
+    if (digits >= 100 || padding_zeros >= 3)
     {
-        uart_putc(labs(value) / 100 + 0x30);
+        uart_putc(digits / 100 + 0x30);
     }
 
-    if (labs(value) >= 10 || padding_zeros >= 2)
+    if (digits >= 10 || padding_zeros >= 2)
     {
-        uart_putc(labs(value) % 100 / 10 + 0x30);
+        uart_putc(digits % 100 / 10 + 0x30);
     }
 
-    uart_putc(value % 10 + 0x30);
+    uart_putc(digits % 10 + 0x30);
+}
+
+/* ------------------------------------------------------------------------- *
+ * Send state of the output and its mode to UART
+ * ------------------------------------------------------------------------- */
+static void uart_put_state(uint8_t on, uint8_t mode)
+{
+    if (on)
+    {
+        uart_puts("ON");
+    }
+    else
+    {
+        uart_puts("OFF");
+    }
+    switch (mode)
+    {
+        case MODE_AUTO: uart_puts(" auto "); break;
+        case MODE_MANUAL: uart_puts(" manual "); break;
+    }
 }
 
 /* ------------------------------------------------------------------------- *
@@ -219,6 +260,53 @@ static uint8_t chr_is_digit(uint8_t chr)
     return 0;
 }
 
+/* ------------------------------------------------------------------------- *
+ * Check if UART buffer matches the pattern from the offset
+ * ('9' in the pattern is any digit, '+' is '+' or '-')
+ * ------------------------------------------------------------------------- */
+static uint8_t match(uint8_t offset, const char *pattern)
+{
+    uint8_t chr;
+    uint8_t expected;
+
+    while ((expected = pgm_read_byte(pattern++)) != 0)
+    {
+        chr = aquarium.uart.buffer[offset++];
+        if (expected == '9')
+        {
+            if (!chr_is_digit(chr))
+            {
+                return 0;
+            }
+        }
+        else if (expected == '+')
+        {
+            if (chr != '+' && chr != '-')
+            {
+                return 0;
+            }
+        }
+        else if (chr != expected)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Send time to UART as HH:MM:SS
+ * ------------------------------------------------------------------------- */
+static void uart_put_time(time_t *time)
+{
+    uart_puti(time->hour, 2);
+    uart_putc(':');
+    uart_puti(time->min, 2);
+    uart_putc(':');
+    uart_puti(time->sec, 2);
+}
+
 /* ------------------------------------------------------------------------- *
  * Extract integer from buffer
  * ------------------------------------------------------------------------- */
@@ -237,20 +325,28 @@ static uint8_t extract_int(uint8_t offset, uint8_t len)
 }
 
 /* ------------------------------------------------------------------------- *
- * Extract time from UART buffer
+ * Extract HH:MM:SS from UART buffer
  * ------------------------------------------------------------------------- */
-static void extract_time(uint8_t offset)
+static void extract_hms(uint8_t offset, time_t *time)
 {
     uint8_t value;
 
     value = extract_int(offset, 2);
-    aquarium.clock.now.hour = value > 23 ? 23 : value;
+    time->hour = value > 23 ? 23 : value;
 
     value = extract_int((offset + 3), 2);
-    aquarium.clock.now.min =value > 59 ? 59 : value;
+    time->min = value > 59 ? 59 : value;
 
     value = extract_int((offset + 6), 2);
-    aquarium.clock.now.sec = value > 59 ? 59 : value;
+    time->sec = value > 59 ? 59 : value;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Extract time from UART buffer
+ * ------------------------------------------------------------------------- */
+static void extract_time(uint8_t offset)
+{
+    extract_hms(offset, (time_t *)&(aquarium.clock.now));
 
     aquarium.clock.now.H12_24 = H24;
     aquarium.clock.now.AMPM = AM;
@@ -291,25 +387,8 @@ static void extract_time_correction(uint8_t offset)
  * ------------------------------------------------------------------------- */
 static void extract_light_thresholds(uint8_t offset)
 {
-    uint8_t value;
-
-    value = extract_int(offset, 2);
-    aquarium.light.time_on.hour = value > 23 ? 23 : value;
-
-    value = extract_int((offset + 3), 2);
-    aquarium.light.time_on.min = value > 59 ? 59 : value;
-
-    value = extract_int((offset + 6), 2);
-    aquarium.light.time_on.sec = value > 59 ? 59 : value;
-
-    value = extract_int((offset + 9), 2);
-    aquarium.light.time_off.hour = value > 23 ? 23 : value;
-
-    value = extract_int((offset + 12), 2);
-    aquarium.light.time_off.min = value > 59 ? 59 : value;
-
-    value = extract_int((offset + 15), 2);
-    aquarium.light.time_off.sec = value > 59 ? 59 : value;
+    extract_hms(offset, &(aquarium.light.time_on));
+    extract_hms((offset + 9), &(aquarium.light.time_off));
 
     eeprom_update_byte(&(config.time_on_hour), aquarium.light.time_on.hour);
     eeprom_update_byte(&(config.time_on_min), aquarium.light.time_on.min);
@@ -386,6 +465,9 @@ void aquarium_init(void)
     aquarium.clock.correction.AMPM = eeprom_read_byte(&(config.daily_corr_sign));
     aquarium.clock.correction.sec = eeprom_read_byte(&(config.daily_corr_sec));
 
+    aquarium.display_day = eeprom_read_byte(&(config.display_day));
+    aquarium.display_night = eeprom_read_byte(&(config.display_night));
+
     aquarium.heater.mode = eeprom_read_byte(&(config.heat_mode));
     aquarium.light.mode = eeprom_read_byte(&(config.light_mode));
     aquarium.display = eeprom_read_byte(&(config.display_mode));
@@ -419,16 +501,24 @@ void aquarium_process_time(void)
     if (date_is_longer(&(aquarium.clock.now), &(aquarium.clock.adjusted))
         && time_is_longer((time_t *)&(aquarium.clock.now), (time_t *)&(aquarium.clock.adjusted)))
     {
-        // ... apply time correction.
+        // ... apply time correction within the minute, so it never carries
+        // to minutes, hours and date (it's less than a minute).
         // Sign of time correction is stored in AMPM
-        switch (aquarium.clock.correction.AMPM)
+        if (aquarium.clock.correction.AMPM == '-')
         {
-            case '+':
-                datetime_add_time(&(aquarium.clock.now), &(aquarium.clock.correction));
-                break;
-            case '-':
-                datetime_sub_time(&(aquarium.clock.now), &(aquarium.clock.correction));
-                break;
+            if (aquarium.clock.now.sec < aquarium.clock.correction.sec)
+            {
+                return;
+            }
+            aquarium.clock.now.sec -= aquarium.clock.correction.sec;
+        }
+        else
+        {
+            if (aquarium.clock.now.sec + aquarium.clock.correction.sec > 59)
+            {
+                return;
+            }
+            aquarium.clock.now.sec += aquarium.clock.correction.sec;
         }
         ds1302_write_datetime(&(aquarium.clock.now));
         // Save date and time of last correction to RAM of RTC
@@ -581,10 +671,12 @@ void aquarium_process_heat(void)
 
 void aquarium_process_light(void)
 {
+    uint8_t is_day = time_is_longer((time_t *)&(aquarium.clock.now), &(aquarium.light.time_on))
+                     && time_is_longer(&(aquarium.light.time_off), (time_t *)&(aquarium.clock.now));
+
     if (aquarium.light.mode == MODE_AUTO)
     {
-        if (time_is_longer((time_t *)&(aquarium.clock.now), &(aquarium.light.time_on))
-            && time_is_longer(&(aquarium.light.time_off), (time_t *)&(aquarium.clock.now)))
+        if (is_day)
         {
             pwm_rise();
         }
@@ -593,6 +685,9 @@ void aquarium_process_light(void)
             pwm_fall();
         }
     }
+
+    // Dim the display at night by the schedule of the light
+    display_level(is_day ? aquarium.display_day : aquarium.display_night);
 }
 
 void aquarium_process_uart(void)
@@ -657,32 +752,18 @@ void aquarium_process_uart(void)
                     uart_putc('.');
                     uart_puti(aquarium.clock.now.year, 2);
                     uart_putc(' ');
-                    switch (aquarium.clock.now.weekday)
+                    if (aquarium.clock.now.weekday >= 1 && aquarium.clock.now.weekday <= 7)
                     {
-                        case 1: uart_puts("Monday"); break;
-                        case 2: uart_puts("Tuesday"); break;
-                        case 3: uart_puts("Wednesday"); break;
-                        case 4: uart_puts("Thursday"); break;
-                        case 5: uart_puts("Friday"); break;
-                        case 6: uart_puts("Saturday"); break;
-                        case 7: uart_puts("Sunday"); break;
+                        uart_puts_p((const char *)pgm_read_word(&(weekdays[aquarium.clock.now.weekday - 1])));
                     }
 
                     uart_puts("\r\nTime: ");
-                    uart_puti(aquarium.clock.now.hour, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.clock.now.min, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.clock.now.sec, 2);
+                    uart_put_time((time_t *)&(aquarium.clock.now));
                     uart_puts(" (");
                     uart_putc(aquarium.clock.correction.AMPM);
                     uart_puti(aquarium.clock.correction.sec, 0);
                     uart_puts(" sec at ");
-                    uart_puti(aquarium.clock.adjusted.hour, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.clock.adjusted.min, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.clock.adjusted.sec, 2);
+                    uart_put_time((time_t *)&(aquarium.clock.adjusted));
                     uart_putc(')');
 
                     uart_puts("\r\nTemp: ");
@@ -696,19 +777,7 @@ void aquarium_process_uart(void)
                     }
 
                     uart_puts("\r\nHeat: ");
-                    if (HEAT_STATE)
-                    {
-                        uart_puts("ON");
-                    }
-                    else
-                    {
-                        uart_puts("OFF");
-                    }
-                    switch (aquarium.heater.mode)
-                    {
-                        case MODE_AUTO: uart_puts(" auto "); break;
-                        case MODE_MANUAL: uart_puts(" manual "); break;
-                    }
+                    uart_put_state(HEAT_STATE, aquarium.heater.mode);
                     uart_putc('(');
                     uart_puti(aquarium.heater.temp_l, 0);
                     uart_putc('-');
@@ -716,31 +785,11 @@ void aquarium_process_uart(void)
                     uart_putc(')');
 
                     uart_puts("\r\nLight: ");
-                    if (pwm_status() & 0x80)
-                    {
-                        uart_puts("ON");
-                    }
-                    else
-                    {
-                        uart_puts("OFF");
-                    }
-                    switch (aquarium.light.mode)
-                    {
-                        case MODE_AUTO: uart_puts(" auto "); break;
-                        case MODE_MANUAL: uart_puts(" manual "); break;
-                    }
+                    uart_put_state(pwm_status() & 0x80, aquarium.light.mode);
                     uart_putc('(');
-                    uart_puti(aquarium.light.time_on.hour, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.light.time_on.min, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.light.time_on.sec, 2);
+                    uart_put_time(&(aquarium.light.time_on));
                     uart_putc('-');
-                    uart_puti(aquarium.light.time_off.hour, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.light.time_off.min, 2);
-                    uart_putc(':');
-                    uart_puti(aquarium.light.time_off.sec, 2);
+                    uart_put_time(&(aquarium.light.time_off));
                     uart_putc(')');
                     uart_putc(' ');
                     uart_puti(pwm_status() & 0x7f, 0);
@@ -757,19 +806,13 @@ void aquarium_process_uart(void)
                         case SHOW_TIME: uart_puts("time"); break;
                         case SHOW_TEMP: uart_puts("temp"); break;
                     }
+                    uart_putc(' ');
+                    uart_puti(aquarium.display_day, 0);
+                    uart_putc('-');
+                    uart_puti(aquarium.display_night, 0);
                     uart_puts("\r\n");
             }
-            else if (strncmp(cmd, "date ", 5) == 0 &&
-                     chr_is_digit(cmd[5]) &&
-                     chr_is_digit(cmd[6]) &&
-                     cmd[7] == '.' &&
-                     chr_is_digit(cmd[8]) &&
-                     chr_is_digit(cmd[9]) &&
-                     cmd[10] == '.' &&
-                     chr_is_digit(cmd[11]) &&
-                     chr_is_digit(cmd[12]) &&
-                     cmd[13] == ' ' &&
-                     chr_is_digit(cmd[14]))
+            else if (match(0, PSTR("date 99.99.99 9")))
             {
                 value = extract_int(5, 2);
                 aquarium.clock.now.day = value > 31 ? 31 : value;
@@ -791,19 +834,9 @@ void aquarium_process_uart(void)
             }
             else if (strncmp(cmd, "time ", 5) == 0)
             {
-                if (chr_is_digit(cmd[5]) &&
-                    chr_is_digit(cmd[6]) &&
-                    cmd[7] == ':' &&
-                    chr_is_digit(cmd[8]) &&
-                    chr_is_digit(cmd[9]) &&
-                    cmd[10] == ':' &&
-                    chr_is_digit(cmd[11]) &&
-                    chr_is_digit(cmd[12]))
+                if (match(5, PSTR("99:99:99")))
                 {
-                    if (cmd[13] == ' ' &&
-                        (cmd[14] == '+'|| cmd[14] == '-') &&
-                        chr_is_digit(cmd[15]) &&
-                        chr_is_digit(cmd[16]))
+                    if (match(13, PSTR(" +99")))
                     {
                         extract_time(5);
                         extract_time_correction(14);
@@ -821,9 +854,7 @@ void aquarium_process_uart(void)
                         uart_response(ERROR);
                     }
                 }
-                else if ((cmd[5] == '+'|| cmd[5] == '-') &&
-                         chr_is_digit(cmd[6]) &&
-                         chr_is_digit(cmd[7]))
+                else if (match(5, PSTR("+99")))
                 {
                     extract_time_correction(5);
 
@@ -836,11 +867,7 @@ void aquarium_process_uart(void)
             }
             else if (strncmp(cmd, "heat ", 5) == 0)
             {
-                if (chr_is_digit(cmd[5]) &&
-                    chr_is_digit(cmd[6]) &&
-                    cmd[7] == '-' &&
-                    chr_is_digit(cmd[8]) &&
-                    chr_is_digit(cmd[9]))
+                if (match(5, PSTR("99-99")))
                 {
                     value = extract_int(5, 2);
                     aquarium.heater.temp_l = value < 18 ? 18 : value;
@@ -882,31 +909,9 @@ void aquarium_process_uart(void)
             }
             else if (strncmp(cmd, "light ", 6) == 0)
             {
-                if (chr_is_digit(cmd[6]) &&
-                    chr_is_digit(cmd[7]) &&
-                    cmd[8] == ':' &&
-                    chr_is_digit(cmd[9]) &&
-                    chr_is_digit(cmd[10]) &&
-                    cmd[11] == ':' &&
-                    chr_is_digit(cmd[12]) &&
-                    chr_is_digit(cmd[13]) &&
-                    cmd[14] == '-' &&
-                    chr_is_digit(cmd[15]) &&
-                    chr_is_digit(cmd[16]) &&
-                    cmd[17] == ':' &&
-                    chr_is_digit(cmd[18]) &&
-                    chr_is_digit(cmd[19]) &&
-                    cmd[20] == ':' &&
-                    chr_is_digit(cmd[21]) &&
-                    chr_is_digit(cmd[22]))
+                if (match(6, PSTR("99:99:99-99:99:99")))
                 {
-                    if (cmd[23] == ' ' &&
-                        chr_is_digit(cmd[24]) &&
-                        chr_is_digit(cmd[25]) &&
-                        chr_is_digit(cmd[26]) &&
-                        cmd[27] == ' ' &&
-                        chr_is_digit(cmd[28]) &&
-                        chr_is_digit(cmd[29]))
+                    if (match(23, PSTR(" 999 99")))
                     {
                         extract_light_thresholds(6);
                         extract_light_level(24);
@@ -950,10 +955,7 @@ void aquarium_process_uart(void)
 
                     uart_response(OK);
                 }
-                else if (strncmp(cmd+6, "level ", 6) == 0 &&
-                         chr_is_digit(cmd[12]) &&
-                         chr_is_digit(cmd[13]) &&
-                         chr_is_digit(cmd[14]))
+                else if (match(6, PSTR("level 999")))
                 {
                     extract_light_level(12);
 
@@ -961,9 +963,7 @@ void aquarium_process_uart(void)
 
                     uart_response(OK);
                 }
-                else if (strncmp(cmd+6, "rise ", 5) == 0 &&
-                         chr_is_digit(cmd[11]) &&
-                         chr_is_digit(cmd[12]))
+                else if (match(6, PSTR("rise 99")))
                 {
                     extract_light_risetime(11);
 
@@ -996,6 +996,21 @@ void aquarium_process_uart(void)
 
                     uart_response(OK);
                 }
+                else if (match(8, PSTR("level 9-9")))
+                {
+                    value = extract_int(14, 1);
+                    aquarium.display_day = value > DISPLAY_LEVEL_MAX ? DISPLAY_LEVEL_MAX : value;
+
+                    value = extract_int(16, 1);
+                    aquarium.display_night = value > DISPLAY_LEVEL_MAX ? DISPLAY_LEVEL_MAX : value;
+
+                    eeprom_update_byte(&(config.display_day), aquarium.display_day);
+                    eeprom_update_byte(&(config.display_night), aquarium.display_night);
+
+                    aquarium_process_light();
+
+                    uart_response(OK);
+                }
                 else
                 {
                     uart_response(ERROR);
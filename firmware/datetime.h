@@ -40,16 +40,6 @@ typedef struct
     uint8_t     year;
 } datetime_t;
 
-/*
- * Add time to datetime.
- */
-extern void datetime_add_time(datetime_t *datetime, time_t *time);
-
-/*
- * Subtract time from datetime.
- */
-extern void datetime_sub_time(datetime_t *datetime, time_t *time);
-
 /*
  * Check if date of datetime1 is longer than date of datetime2.
  */
@@ -8,40 +8,85 @@
  */
 
 #include <avr/interrupt.h>
-#include <stdlib.h>
+#include <avr/pgmspace.h>
 
 #include "display.h"
 #include "ds18b20.h"
 
 #define MSG_DELAY 3906 // 3906 * 256us (T2_OVF) = 1 sec
 
-static volatile uint8_t display[4];
-static volatile uint8_t current_digit;
-static volatile uint8_t current_segment;
+// Pins of the display on each port
+#define DISPLAY_PORTB 0x83
+#define DISPLAY_PORTC 0x38
+#define DISPLAY_PORTD 0xFC
+
+// Segments are turned on by low level, digits - by high level
+#define SEGMENTS_OFF_PORTB ((1 << PB7) | (1 << PB0))
+#define SEGMENTS_OFF_PORTD DISPLAY_PORTD
+
+static uint8_t display[4];
+static volatile uint8_t current_step;
 static volatile uint16_t message_delay;
+static volatile uint8_t display_is_on;
+static volatile uint8_t display_compare;
 
-typedef struct
+/*
+ * The display is scanned by one segment at a time: 4 digits * 8 segments.
+ * The state of PORTB and PORTD for every step is calculated once when the
+ * display is changed, so the ISR only copies it to the ports.
+ */
+static volatile struct
 {
-    volatile uint8_t *port;
-    uint8_t pin;
-} pin_t;
-
-static const pin_t digits[4] = {
-    {&PORTB, PB1}, // 1
-    {&PORTC, PC5}, // 2
-    {&PORTC, PC4}, // 3
-    {&PORTC, PC3}  // 4
+    uint8_t portb;
+    uint8_t portd;
+} frame[32];
+
+// Digit pins on PORTB and PORTC
+static const uint8_t digits_portb[4] = {
+    (1 << PB1), // 1
+    0x00,       // 2
+    0x00,       // 3
+    0x00        // 4
+};
+
+static const uint8_t digits_portc[4] = {
+    0x00,       // 1
+    (1 << PC5), // 2
+    (1 << PC4), // 3
+    (1 << PC3)  // 4
 };
 
-static const pin_t segments[8] = {
-    {&PORTD, PD4}, // A
-    {&PORTD, PD2}, // B
-    {&PORTD, PD7}, // C
-    {&PORTD, PD5}, // D
-    {&PORTB, PB7}, // E
-    {&PORTD, PD3}, // F
-    {&PORTB, PB0}, // G
-    {&PORTD, PD6}  // H
+/*
+ * Share of the scan step (256 us) when the segment is on (OCR2 value)
+ * for each brightness level. The eye is more sensitive to the changes of
+ * low brightness, so the steps grow geometrically. The segment can't be
+ * turned off earlier than the overflow interrupt ends (~12 timer counts).
+ */
+static const uint8_t levels[DISPLAY_LEVEL_MAX] PROGMEM = {
+    16, 24, 35, 52, 77, 114, 169, 255
+};
+
+// Segment pins on PORTB and PORTD
+static const uint8_t segments_portb[8] = {
+    0x00,       // A
+    0x00,       // B
+    0x00,       // C
+    0x00,       // D
+    (1 << PB7), // E
+    0x00,       // F
+    (1 << PB0), // G
+    0x00        // H
+};
+
+static const uint8_t segments_portd[8] = {
+    (1 << PD4), // A
+    (1 << PD2), // B
+    (1 << PD7), // C
+    (1 << PD5), // D
+    0x00,       // E
+    (1 << PD3), // F
+    0x00,       // G
+    (1 << PD6)  // H
 };
 
 static const uint8_t symbols[] = {
@@ -65,6 +110,46 @@ static const uint8_t symbols[] = {
 //  0b01111000       t  - 0x78
 //  0b01000000       -  - 0x40
 
+/* ------------------------------------------------------------------------- *
+ * Turn off the current segment before the end of its scan step
+ * ------------------------------------------------------------------------- */
+static inline void display_blank(void)
+{
+    PORTD |= SEGMENTS_OFF_PORTD;
+    PORTB |= SEGMENTS_OFF_PORTB;
+}
+
+/* ------------------------------------------------------------------------- *
+ * Calculate the state of the ports for every step of scanning
+ * ------------------------------------------------------------------------- */
+static void display_update(void)
+{
+    uint8_t digit;
+    uint8_t segment;
+    uint8_t step = 0;
+    uint8_t portb;
+    uint8_t portd;
+
+    for (digit = 0; digit < 4; digit++)
+    {
+        for (segment = 0; segment < 8; segment++)
+        {
+            portb = SEGMENTS_OFF_PORTB | digits_portb[digit];
+            portd = SEGMENTS_OFF_PORTD;
+            if (display[digit] & (1 << segment))
+            {
+                portb &= ~segments_portb[segment];
+                portd &= ~segments_portd[segment];
+            }
+
+            // A step may be shown half-updated once, it isn't visible
+            frame[step].portb = portb;
+            frame[step].portd = portd;
+            step++;
+        }
+    }
+}
+
 void display_init(void)
 {
     // I/O ports
@@ -79,14 +164,36 @@ void display_init(void)
     TCCR2 |= (1 << CS21); // Normal mode, clk/8
     TCNT2 = 0x00; // 256 us
     TIMSK |= (1 << TOIE2); // Enable overflow on timer 2
+    TIMSK |= (1 << OCIE2); // Enable compare match on timer 2 (brightness)
 
     // Variables
-    current_digit = 0;
-    current_segment = 0;
+    current_step = 0;
+    display_level(DISPLAY_LEVEL_MAX);
     display[0] = 0xff;
     display[1] = 0xff;
     display[2] = 0xff;
     display[3] = 0xff;
+    display_update();
+}
+
+void display_level(uint8_t level)
+{
+    if (level == 0)
+    {
+        display_is_on = 0;
+        display_blank();
+        return;
+    }
+
+    if (level > DISPLAY_LEVEL_MAX)
+    {
+        level = DISPLAY_LEVEL_MAX;
+    }
+
+    // Segments are turned off by T2 compare interrupt. The compare point is
+    // changed at the overflow only (see the interrupt).
+    display_compare = pgm_read_byte(&(levels[level - 1]));
+    display_is_on = 1;
 }
 
 void display_time(time_t *time)
@@ -106,10 +213,14 @@ void display_time(time_t *time)
         display[0] |= 0x80;
         display[1] |= 0x80;
     }
+
+    display_update();
 }
 
 void display_temp(int8_t temp)
 {
+    uint8_t value = (temp < 0) ? -temp : temp;
+
     if (message_delay > 0)
     {
         return;
@@ -123,27 +234,29 @@ void display_temp(int8_t temp)
         display[2] = 0x40;
         display[3] = 0x00;
     }
-    else if (labs(temp) < 10)
+    else if (value < 10)
     {
         display[0] = 0x00;
-        display[1] = symbols[labs(temp)];
+        display[1] = symbols[value];
         display[2] = (temp < 0) ? 0x40 : 0x00;
         display[3] = 0x00;
     }
-    else if (labs(temp) < 100)
+    else if (value < 100)
     {
         display[0] = 0x00;
-        display[1] = symbols[labs(temp) % 10];
-        display[2] = symbols[labs(temp) / 10];
+        display[1] = symbols[value % 10];
+        display[2] = symbols[value / 10];
         display[3] = (temp < 0) ? 0x40 : 0x00;
     }
     else
     {
-        display[0] = symbols[labs(temp) % 10];
-        display[1] = symbols[labs(temp) % 100 / 10];
-        display[2] = symbols[labs(temp) % 1000 / 100];
+        display[0] = symbols[value % 10];
+        display[1] = symbols[value % 100 / 10];
+        display[2] = symbols[value / 100];
         display[3] = 0x00;
     }
+
+    display_update();
 }
 
 void display_message_on(void)
@@ -152,6 +265,7 @@ void display_message_on(void)
     display[1] = 0x54;
     display[2] = 0x3f;
     display[3] = 0x00;
+    display_update();
     message_delay = MSG_DELAY;
 }
 
@@ -161,6 +275,7 @@ void display_message_off(void)
     display[1] = 0x71;
     display[2] = 0x3f;
     display[3] = 0x00;
+    display_update();
     message_delay = MSG_DELAY;
 }
 
@@ -170,45 +285,48 @@ void display_message_auto(void)
     display[1] = 0x78;
     display[2] = 0x3E;
     display[3] = 0x77;
+    display_update();
     message_delay = MSG_DELAY;
 }
 
+/* ------------------------------------------------------------------------- *
+ * Show the next step of the frame
+ * ------------------------------------------------------------------------- */
 ISR (TIMER2_OVF_vect)
 {
-    uint8_t i;
+    uint8_t step = current_step;
 
-    // Turn off all digits
-    for (i = 0; i < 4; i++)
-    {
-        *(digits[i].port) &= ~(1 << digits[i].pin);
-    }
+    OCR2 = display_compare;
+    current_step = (step + 1) & 0x1f;
 
-    // Turn off all segments
-    for (i = 0; i < 8; i++)
+    if (message_delay > 0)
     {
-        *(segments[i].port) |= (1 << segments[i].pin);
+        message_delay -= 1;
     }
 
-    // Turn on current segment if needed
-    if (display[current_digit] & (1 << current_segment))
+    // All steps are blank when the display is off
+    if (!display_is_on)
     {
-        *(segments[current_segment].port) &= ~(1 << segments[current_segment].pin);
+        return;
     }
 
-    // Turn on current digit
-    *(digits[current_digit].port) |= (1 << digits[current_digit].pin);
-
-    if (++current_segment > 7)
-    {
-        current_segment = 0;
-        if (++current_digit > 3)
-        {
-            current_digit = 0;
-        } // All digits 0..3
-    } // All segments 0..7
+    PORTD = (PORTD & ~DISPLAY_PORTD) | frame[step].portd;
+    PORTB = (PORTB & ~DISPLAY_PORTB) | frame[step].portb;
+    PORTC = (PORTC & ~DISPLAY_PORTC) | digits_portc[step >> 3];
 
-    if (message_delay > 0)
+    // The interrupt may start late (after another one), then the compare
+    // point may be already passed and the segment would stay on for the
+    // whole step: keep it off instead
+    if (TCNT2 >= display_compare)
     {
-        message_delay -= 1;
+        display_blank();
     }
 }
+
+/* ------------------------------------------------------------------------- *
+ * Turn off the segment at the end of its share of the step
+ * ------------------------------------------------------------------------- */
+ISR (TIMER2_COMP_vect)
+{
+    display_blank();
+}
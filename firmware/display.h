@@ -14,11 +14,21 @@
 
 #include "datetime.h"
 
+/*
+ * Max. brightness level of the display (0 - the display is off).
+ */
+#define DISPLAY_LEVEL_MAX 8
+
 /*
  * Initialize the I/O and interrupts for display working.
  */
 extern void display_init(void);
 
+/*
+ * Set brightness level of the display (0-DISPLAY_LEVEL_MAX).
+ */
+extern void display_level(uint8_t level);
+
 /*
  * Show time on the display.
  */
@@ -11,6 +11,7 @@
 #include <avr/wdt.h>
 
 #include "aquarium.h"
+#include "pwm.h"
 
 int main(void)
 {
@@ -50,5 +51,6 @@ int main(void)
         }
 
         aquarium_process_uart();
+        pwm_process();
     }
 }
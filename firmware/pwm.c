@@ -8,44 +8,120 @@
  */
 
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #include "pwm.h"
 
+/*
+ * T0 overflows every 1024 * 256 / F_CPU = 32.768 ms (30.5 Hz),
+ * it moves the fade by one step.
+ */
+#define PWM_TICKS_PER_MIN ((uint16_t)(F_CPU * 60UL / 1024 / 256)) // 1831
+
+/*
+ * Duty cycle (OCR1B) for 33 points of perceived brightness (CIE 1931
+ * lightness) from 0 to 100% in steps of 1/32. The eye sees the changes of
+ * low brightness much better, so the duty cycle grows slowly at first and
+ * quickly at the end. The points between are interpolated linearly
+ * (within 2% of the curve).
+ */
+#define PWM_GAMMA_POINTS 33
+
+static const uint16_t gamma[PWM_GAMMA_POINTS] PROGMEM = {
+        0,   227,   453,   686,   972,  1328,  1762,  2281,
+     2894,  3607,  4429,  5367,  6429,  7623,  8956, 10436,
+    12071, 13868, 15835, 17980, 20310, 22833, 25558, 28490,
+    31639, 35012, 38616, 42460, 46550, 50895, 55503, 60380,
+    65535
+};
+
 static uint8_t pwm_is_rising = 0;
+// Brightness of the light when it's on (perceived, 0xffff - 100%)
 static uint16_t pwm_level = 0;
-static union {
-    uint16_t full;
-    struct {
-        uint8_t low;
-        uint8_t high;
-    };
-} pwm_risetime;
-static uint8_t skipping_counter;
+// Time of the fade from 0 to pwm_level in T0 ticks
+static uint16_t pwm_risetime;
+
+/*
+ * The fade moves the brightness by pwm_level / pwm_risetime every tick:
+ * by "step", and by one more when the remainders add up to a whole
+ * (as Bresenham's line), so the full fade takes exactly pwm_risetime ticks.
+ */
+static uint16_t pwm_position;
+static uint16_t pwm_target;
+static uint16_t pwm_step;
+static uint16_t pwm_remainder;
+static uint16_t pwm_error;
+
+/*
+ * The duty cycle of the next tick is calculated in the main loop, so the
+ * interrupt only stores it and counts the tick. The watchdog resets the
+ * controller if the main loop stops for 1 sec, so 8 bits of ticks are
+ * enough.
+ */
+static volatile uint16_t pwm_next;
+static volatile uint8_t pwm_ticks;
+
+/* ------------------------------------------------------------------------- *
+ * Get the duty cycle for the brightness
+ * ------------------------------------------------------------------------- */
+static uint16_t pwm_gamma(uint16_t position)
+{
+    uint16_t low;
+    uint16_t high;
+    uint8_t i;
+
+    if (position == 0xffff)
+    {
+        return 0xffff;
+    }
+
+    // 32 segments of 2048
+    i = position >> 11;
+    low = pgm_read_word(&(gamma[i]));
+    high = pgm_read_word(&(gamma[i + 1]));
+
+    return low + (uint16_t)(((uint32_t)(high - low) * (position & 0x7ff)) >> 11);
+}
+
+/* ------------------------------------------------------------------------- *
+ * Show the current brightness, stop the fade at the target
+ * ------------------------------------------------------------------------- */
+static void pwm_output(void)
+{
+    uint16_t value = pwm_gamma(pwm_position);
+
+    cli();
+    if (pwm_position == pwm_target)
+    {
+        TIMSK &= ~(1 << TOIE0); // Disable PWM's timer
+        OCR1B = value;
+    }
+    pwm_next = value;
+    sei();
+}
 
 /* ------------------------------------------------------------------------- *
- * Update PWM state
+ * Move the light from the current brightness to the target
  * ------------------------------------------------------------------------- */
-static void pwm_update(void)
+static void pwm_fade(uint16_t target)
 {
-    if (pwm_risetime.full == 0)
+    pwm_target = target;
+
+    if (pwm_risetime == 0 || pwm_level == 0)
     {
         // Turn on/off light immediately
-        if (pwm_is_rising)
-        {
-            pwm_on();
-        }
-        else
-        {
-            pwm_off();
-        }
+        pwm_position = target;
     }
-    else
+    else if (pwm_position != target)
     {
         // Turn on/off light gradually
-        skipping_counter = pwm_risetime.high;
-        TCNT0 = pwm_risetime.low;
+        pwm_step = pwm_level / pwm_risetime;
+        pwm_remainder = pwm_level % pwm_risetime;
+        pwm_error = 0;
         TIMSK |= (1 << TOIE0); // Enable PWM's timer
     }
+
+    pwm_output();
 }
 
 void pwm_init(void)
@@ -58,12 +134,10 @@ void pwm_init(void)
 
     /*
      * Timer/Counter 0.
-     * Increase PWM level every 27.52ms.
-     * From 0 to 100% in ~30 minutes (65535 * 27.52ms).
+     * Free running with prescaler clk/1024, overflow every 32.768 ms.
+     * The overflow interrupt is enabled only while the light fades.
      */
     TCCR0 = 0x05;               // Prescaler clk/1024
-    TCNT0 = 0x29;               // 27.52 ms
-    TIMSK |= (1 << TOIE0);      // Enable overflow on timer 0
 
     /*
      * Timer/Counter 1
@@ -76,28 +150,54 @@ void pwm_init(void)
 
 void pwm_setup(uint8_t level, uint8_t risetime)
 {
-    pwm_level = (level == 100) ? 0xffff : level * PWM_LEVEL_STEP;
-    /*
-     * F_CPU = 8000000 Hz
-     * T0_tick = 1 / F_CPU / prescaler = 1 / 8000000 / 1024 = 0.000128 sec
-     * Increasing PWM level from 0 to 65535 (100%) every T0_tick takes:
-     * 0.000128 * 65535 = 8.4 sec
-     * To rise light from 0 to 100% in 1 minute it needs about 7 T0_ticks:
-     * (7 * 0.000128) * 65535 = 59 sec
-     * To rise light from 0 to 100% in n minutes the T0 must count 7n cycles
-     * between increasing PWM level:
-     * pwm_risetime.full = 7 * risetime;
-     * To rise light from 0 to "level"% in n minutes the previous value must be
-     * compensated by level percentage:
-     * pwm_risetime.full = (7 * risetime) * (100 / level);
-     * This value is greater than T0 can count, so additional variable
-     * "skipping_counter" is used to expand T0 from one byte to two bytes.
-     * T0 counts from "pwm_risetime.low" up to 0xff (and overflows),
-     * then T0 counts from 0x00 up to 0xff "pwm_risetime.high" times and only
-     * then increases PWM level.
-     */
-    pwm_risetime.full = (risetime == 0 || level == 0) ? 0 : ((700 * risetime) / level);
-    pwm_update();
+    pwm_level = (level >= 100) ? 0xffff : level * PWM_LEVEL_STEP;
+    // The light rises from 0 to "level" in "risetime" minutes
+    pwm_risetime = risetime * PWM_TICKS_PER_MIN;
+    pwm_fade(pwm_is_rising ? pwm_level : 0);
+}
+
+void pwm_process(void)
+{
+    uint8_t ticks;
+    uint16_t step;
+    uint16_t left;
+
+    cli();
+    ticks = pwm_ticks;
+    pwm_ticks = 0;
+    sei();
+
+    if (ticks == 0)
+    {
+        return;
+    }
+
+    while (ticks-- > 0 && pwm_position != pwm_target)
+    {
+        step = pwm_step;
+        if (pwm_error >= pwm_risetime - pwm_remainder)
+        {
+            pwm_error -= pwm_risetime - pwm_remainder;
+            step += 1;
+        }
+        else
+        {
+            pwm_error += pwm_remainder;
+        }
+
+        if (pwm_position < pwm_target)
+        {
+            left = pwm_target - pwm_position;
+            pwm_position += (step < left) ? step : left;
+        }
+        else
+        {
+            left = pwm_position - pwm_target;
+            pwm_position -= (step < left) ? step : left;
+        }
+    }
+
+    pwm_output();
 }
 
 uint8_t pwm_status(void)
@@ -105,7 +205,7 @@ uint8_t pwm_status(void)
     uint8_t status;
 
     // Current light brightness in percent.
-    status = (uint8_t)(OCR1B / PWM_LEVEL_STEP);
+    status = (uint8_t)(pwm_position / PWM_LEVEL_STEP);
     // Highest bit shows direction of PWM: 0 - falling, 1 - rising.
     status = pwm_is_rising ? status | 0x80 : status & 0x7f;
 
@@ -114,16 +214,16 @@ uint8_t pwm_status(void)
 
 void pwm_on(void)
 {
-    TIMSK &= ~(1 << TOIE0); // Disable PWM's timer
     pwm_is_rising = 1;
-    OCR1B = pwm_level;
+    pwm_position = pwm_level;
+    pwm_fade(pwm_level);
 }
 
 void pwm_off(void)
 {
-    TIMSK &= ~(1 << TOIE0); // Disable PWM's timer
     pwm_is_rising = 0;
-    OCR1B = 0;
+    pwm_position = 0;
+    pwm_fade(0);
 }
 
 void pwm_rise(void)
@@ -131,7 +231,7 @@ void pwm_rise(void)
     if (!pwm_is_rising)
     {
         pwm_is_rising = 1;
-        pwm_update();
+        pwm_fade(pwm_level);
     }
 }
 
@@ -140,51 +240,15 @@ void pwm_fall(void)
     if (pwm_is_rising)
     {
         pwm_is_rising = 0;
-        pwm_update();
+        pwm_fade(0);
     }
 }
 
 /* ------------------------------------------------------------------------- *
- * Change PWM level by one step up or down
+ * Show the duty cycle of the tick
  * ------------------------------------------------------------------------- */
 ISR (TIMER0_OVF_vect)
 {
-    if (skipping_counter > 0)
-    {
-        skipping_counter -= 1;
-        return;
-    }
-
-    // Initialize timer
-    skipping_counter = pwm_risetime.high;
-    TCNT0 = 0xff - pwm_risetime.low;
-
-    if (pwm_is_rising)
-    {
-        if (OCR1B < pwm_level)
-        {
-            OCR1B += 1;
-        }
-        else if (OCR1B > pwm_level)
-        {
-            OCR1B -= 1;
-        }
-        else
-        {
-            // Light has turned on with specified brightness
-            TIMSK &= ~(1 << TOIE0); // Disable PWM's timer
-        }
-    }
-    else
-    {
-        if (OCR1B > 0)
-        {
-            OCR1B -= 1;
-        }
-        else
-        {
-            // Light has turned off
-            TIMSK &= ~(1 << TOIE0); // Disable PWM's timer
-        }
-    }
+    OCR1B = pwm_next;
+    pwm_ticks += 1;
 }
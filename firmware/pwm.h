@@ -12,7 +12,7 @@
 
 #include <avr/io.h>
 
-#define PWM_LEVEL_STEP 655 // 65535/100
+#define PWM_LEVEL_STEP 655 // 65535 / 100 (perceived brightness)
 
 /*
  * Initialize the PWM for controlling the light.
@@ -21,11 +21,16 @@ extern void pwm_init(void);
 
 /*
  * Setup PWM.
- * level - brightness level in percent.
- * risetime - light rise time in minutes.
+ * level - brightness level in percent (perceived, gamma corrected).
+ * risetime - time of the light rising from 0 to "level" in minutes.
  */
 extern void pwm_setup(uint8_t level, uint8_t risetime);
 
+/*
+ * Move the fade by the passed ticks, it's called from the main loop.
+ */
+extern void pwm_process(void);
+
 /*
  * Turn on the light immediately.
  */